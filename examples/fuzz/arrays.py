@@ -0,0 +1,128 @@
+"""Random functions that live on small private arrays, compiled at -O0, -O1 and -O2 and run.
+
+usage: python3 examples/fuzz/arrays.py <risk> <first seed> <count> [flags...]
+
+Arrays are indexed by constants most of the time, which scalar replacement
+splits into values, and by a masked variable now and then, which keeps them in
+the frame. Some are passed whole as slices, declared inside loops or of `u8`.
+Each flag adds a run at -O2 with it, like `--keep-arrays`.
+"""
+
+import os, random, sys, tempfile
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import fuzz
+
+def gen(seed):
+    r = random.Random(seed)
+    out = []
+    def lit():
+        return str(r.choice([0, 1, 2, 3, 7, 100, 255, 256, 300, -1, -5, 0x7fffffff, 5000000000]) ).replace('-', '0 - ')
+    def expr(vs, arrs, d):
+        if d <= 0 or r.random() < 0.3:
+            c = r.random()
+            if c < 0.5 and vs: return r.choice(vs)
+            if c < 0.75 and arrs:
+                name, n, _ = r.choice(arrs)
+                if r.random() < 0.85: return f'{name}[{r.randrange(n)}]'
+                return f'{name}[({r.choice(vs) if vs else "1"} & 1023) % {n}]'
+            return lit()
+        op = r.choice(['+', '-', '*', '&', '^', '|'])
+        return f'({expr(vs, arrs, d-1)} {op} {expr(vs, arrs, d-1)})'
+    def body(vs, arrs, muts, d, ind):
+        lines = []
+        for _ in range(r.randint(1, 5)):
+            k = r.random()
+            marrs = [a for a in arrs if a[2]]
+            if k < 0.35 and marrs:
+                name, n, _ = r.choice(marrs)
+                idx = str(r.randrange(n)) if r.random() < 0.85 else f'({r.choice(vs)} & 1023) % {n}'
+                lines.append(f'{ind}{name}[{idx}] {r.choice(["=", "+=", "-="])} {expr(vs, arrs, 2)};')
+            elif k < 0.5 and muts:
+                lines.append(f'{ind}{r.choice(muts)} += {expr(vs, arrs, 2)};')
+            elif k < 0.65 and d > 0:
+                lines.append(f'{ind}if {expr(vs, arrs, 1)} > {expr(vs, arrs, 1)} {{')
+                lines += body(vs, arrs, muts, d-1, ind + '    ')
+                lines.append(f'{ind}}} else {{')
+                lines += body(vs, arrs, muts, d-1, ind + '    ')
+                lines.append(f'{ind}}};')
+            elif k < 0.8 and d > 0:
+                i = f'i{r.randint(0, 99999)}'
+                lines.append(f'{ind}let mut {i} = 0;')
+                lines.append(f'{ind}while {i} < {r.randint(0, 6)} {{')
+                lines.append(f'{ind}    {i} += 1;')
+                inner = list(arrs)
+                if r.random() < 0.3:
+                    nm = f'q{r.randint(0, 99999)}'
+                    n = r.randint(1, 5)
+                    lines.append(f'{ind}    let mut {nm} = [{", ".join(expr(vs + [i], arrs, 1) for _ in range(n))}];')
+                    inner.append((nm, n, True))
+                lines += body(vs + [i], inner, muts, d-1, ind + '    ')
+                if r.random() < 0.3:
+                    lines.append(f'{ind}    if {expr(vs + [i], inner, 1)} == 3 {{ break; }};')
+                lines.append(f'{ind}}};')
+            elif k < 0.85 and arrs and sfns:
+                f, u8 = r.choice(sfns)
+                srcs = [a for a in arrs if (a[0] in u8s) == u8]
+                if srcs and muts:
+                    name, n, _ = r.choice(srcs)
+                    lines.append(f'{ind}{r.choice(muts)} += {f}({name}[..]);')
+            else:
+                v = f'l{r.randint(0, 99999)}'
+                lines.append(f'{ind}let {v} = {expr(vs, arrs, 2)};')
+                vs = vs + [v]
+        return lines
+    u8s = set()
+    sfns = []
+    for i in range(r.randint(0, 2)):
+        u8 = r.random() < 0.4
+        out.append(f'[|inline(never)|]\nfn s{i}(xs: []{"u8" if u8 else "i64"}) i64 {{\n    let mut t = 0;\n    let mut j = 0;\n    while j < xs.len {{ t = t * 3 + xs[j]; j += 1; }};\n    t\n}}')
+        sfns.append((f's{i}', u8))
+    fns = []
+    for i in range(r.randint(1, 4)):
+        nargs = r.randint(0, 3)
+        params = [f'p{j}' for j in range(nargs)]
+        attr = r.choice(['', '', '[|inline(always)|]\n', '[|inline(never)|]\n'])
+        lines = [f'{attr}fn f{i}(' + ', '.join(f'{p}: i64' for p in params) + ') i64 {']
+        lines.append(f'    let mut m0 = {expr(params, [], 1)};')
+        arrs = []
+        for a in range(r.randint(1, 3)):
+            nm = f'a{i}_{a}'
+            c = r.random()
+            n = r.choice([1, 2, 3, 4, 5, 8, 17])
+            if c < 0.3:
+                lines.append(f'    let mut {nm} = [{", ".join(expr(params, [], 1) for _ in range(n))}];')
+            elif c < 0.5:
+                lines.append(f'    let mut {nm} = [{expr(params, [], 1)}] * {n};')
+            elif c < 0.65:
+                lines.append(f'    let mut {nm} = [0] * {n};')
+            elif c < 0.8:
+                lines.append(f'    let mut {nm}: [{n}]u8;')
+                u8s.add(nm)
+            else:
+                lines.append(f'    let mut {nm}: [{n}]i64;')
+            arrs.append((nm, n, True))
+        lines += body(params + ['m0'], arrs, ['m0'], 3, '    ')
+        lines.append(f'    {expr(params + ["m0"], arrs, 3)}')
+        lines.append('}')
+        out.append('\n'.join(lines))
+        fns.append((f'f{i}', nargs))
+    mb = ['fn main() i32 {', '    let mut h = 0;']
+    for f, n in fns:
+        for _ in range(2):
+            mb.append(f'    h = h * 31 + {f}({", ".join(str(r.randint(0, 20)) for _ in range(n))});')
+    mb.append('    h & 255')
+    mb.append('}')
+    out.append('\n'.join(mb))
+    return '\n\n'.join(out) + '\n'
+
+if __name__ == '__main__':
+    risk = os.path.abspath(sys.argv[1])
+    start, count = int(sys.argv[2]), int(sys.argv[3])
+    runs = fuzz.LEVELS + [['-O2', flag] for flag in sys.argv[4:]]
+    bad = 0
+    with tempfile.TemporaryDirectory() as work:
+        for seed in range(start, start + count):
+            bad += not fuzz.check(risk, 'arrays', seed, gen(seed), runs, work)
+    print('bad', bad)
+    sys.exit(bad != 0)
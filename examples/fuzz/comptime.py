@@ -0,0 +1,79 @@
+"""The functions of fuzz.py, called at compile time and at run time; all must agree.
+
+usage: python3 examples/fuzz/comptime.py <risk> <first seed> <count>
+
+Every function that can be evaluated at compile time gets a `let comptime` in
+`main`, which returns the number of the first one that differs from the same
+call at run time. The LIR with bytecode must also equal the LIR with
+`--tree-comptime`, down to the diagnostics.
+"""
+
+import os, random, re, subprocess, sys, tempfile
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import fuzz
+
+def lower(risk, path, flags=()):
+    return subprocess.run([risk, *flags, '--lir', path], capture_output=True, text=True)
+
+def write(path, src):
+    with open(path, 'w') as file:
+        file.write(src)
+
+def check(risk, seed, work):
+    """true unless the seed has a call that disagrees, 0 calls checked for a seed with none"""
+    src = fuzz.gen(seed)
+    src = src[:src.index('fn main()')]
+    r = random.Random(seed)
+    path = os.path.join(work, f'comptime-{seed}.rk')
+
+    # arrays, slices and `std::` calls are errors at compile time, those functions are left out
+    calls = []
+    for name, params in re.findall(r'^fn (f\d+)\(([^)]*)\)', src, re.M):
+        n = 0 if not params else params.count(',') + 1
+        args = ', '.join(str(r.randint(-20, 20)).replace('-', '0 - ') for _ in range(n))
+        write(path, src + f'fn main() i32 {{\n    let comptime C = {name}({args});\n    0\n}}\n')
+        if lower(risk, path).returncode == 0:
+            calls.append((name, args))
+    if not calls:
+        return True, 0
+
+    main = ['fn main() i32 {']
+    for i, (name, args) in enumerate(calls):
+        main.append(f'    let comptime C{i} = {name}({args});')
+        main.append(f'    if C{i} != {name}({args}) {{ return {i + 1}; }};')
+    main += ['    0', '}']
+    src += '\n'.join(main) + '\n'
+    write(path, src)
+
+    problem = None
+    vm, tree = lower(risk, path), lower(risk, path, ['--tree-comptime'])
+    p = subprocess.run([risk, '--emit', 'exe', path], capture_output=True, text=True)
+    if vm.stdout != tree.stdout or vm.stderr != tree.stderr:
+        problem = 'bytecode and tree differ'
+    elif p.returncode != 0:
+        problem = 'compile ' + (p.stdout + p.stderr)[-300:]
+    else:
+        try:
+            code = subprocess.run([path[:-3]], capture_output=True, timeout=10).returncode
+        except subprocess.TimeoutExpired:
+            code = 'timeout'
+        if code != 0:
+            problem = f'run differs in {calls[code - 1]}' if isinstance(code, int) and 0 < code <= len(calls) else f'exit {code}'
+    if problem is None:
+        return True, len(calls)
+    print(seed, problem)
+    write(f'comptime-{seed}.rk', src)
+    return False, len(calls)
+
+if __name__ == '__main__':
+    risk = os.path.abspath(sys.argv[1])
+    start, count = int(sys.argv[2]), int(sys.argv[3])
+    bad = checked = 0
+    with tempfile.TemporaryDirectory() as work:
+        for seed in range(start, start + count):
+            ok, calls = check(risk, seed, work)
+            bad += not ok
+            checked += calls
+    print('bad', bad, 'checked', checked)
+    sys.exit(bad != 0)
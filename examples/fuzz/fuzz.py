@@ -0,0 +1,247 @@
+"""Random programs, each compiled at -O0, -O1 and -O2 and run; all three must exit the same.
+
+usage: python3 examples/fuzz/fuzz.py <risk> <first seed> <count> [flags...]
+
+Each flag adds a run at -O2 with that flag, like `--keep-checks`.
+
+A program is a few functions over i64 and arrays with loops, matches, calls and
+early returns, and `main` folds their results into the exit code. A seed that
+fails is kept as `fuzz-<seed>.rk` in the current directory to reduce by hand.
+"""
+
+import os, random, subprocess, sys, tempfile
+
+def gen(seed):
+    r = random.Random(seed)
+    nfn = r.randint(2, 6)
+    out = []
+    arrs = []  # (name, len or None for slices, mutable)
+
+    def index(a, name, n):
+        c = r.random()
+        if c < 0.5 and n:
+            return f'({a} & {n - 1})' if n & (n - 1) == 0 else f'(({a} & 255) % {n})'
+        if c < 0.96:
+            return f'(({a} & 1023) % ({name}.len + 1))' if r.random() < 0.1 else f'(({a} & 1023) % {name}.len)'
+        return a
+
+    def expr(vars_, depth, fns):
+        if depth <= 0 or r.random() < 0.3:
+            c = r.random()
+            if c < 0.55 and vars_:
+                return r.choice(vars_)
+            if c < 0.7:
+                return str(r.choice([0, 1, 2, 3, 7, 8, 16, 100, 255, 0x7fffffff, 0x100000000, 5000000000]))
+            return str(r.randint(-50, 50)).replace('-', '0 - ')
+        k = r.random()
+        a = expr(vars_, depth - 1, fns)
+        b = expr(vars_, depth - 1, fns)
+        if k < 0.45:
+            op = r.choice(['+', '-', '*', '&', '|', '^'])
+            return f'({a} {op} {b})'
+        if k < 0.55:
+            return f'({a} / (({b} & 7) + 1))'
+        if k < 0.6:
+            return f'({a} % (({b} & 15) + 1))'
+        if k < 0.66:
+            return f'({a} {r.choice(["<<", ">>"])} ({b} & 15))'
+        if k < 0.74:
+            return f'(if {a} {r.choice(["<", "<=", ">", ">=", "==", "!="])} {b} {{ {expr(vars_, depth - 1, fns)} }} else {{ {expr(vars_, depth - 1, fns)} }})'
+        if k < 0.8:
+            return f'(0 - {a})'
+        if k < 0.84:
+            return f'(~{a})'
+        if k < 0.87 and arrs:
+            name, n, _ = r.choice(arrs)
+            return f'{name}[{index(a, name, n)}]'
+        if k < 0.9 and fns:
+            f, n = r.choice(fns)
+            args = ', '.join(expr(vars_, depth - 2, fns) for _ in range(n))
+            return f'{f}({args})'
+        if k < 0.92:
+            return f'(match {a} & 7 {{ 0 => {b}, 1 | 2 => {expr(vars_, depth - 1, fns)}, 3..=5 => 7, _ => {a} }})'
+        if k < 0.95:
+            arms = []
+            base = r.choice([0, 0, 30, 5000000000, 9223372036854775000])
+            for _ in range(r.randint(1, 14)):
+                c = r.random()
+                x = base + r.randint(0, r.choice([8, 20, 300]))
+                body = expr(vars_, depth - 2, fns) if r.random() < 0.3 else str(r.randint(0, 99))
+                if c < 0.45:
+                    pat = str(x)
+                elif c < 0.6:
+                    pat = f'{x} | {x + r.randint(1, 5)}'
+                elif c < 0.75:
+                    pat = f'{x}..={x + r.randint(0, 6)}'
+                elif c < 0.85:
+                    pat = f'{x}..{x + r.randint(0, 6)}'
+                elif c < 0.9:
+                    pat = f'..{x}' if r.random() < 0.5 else f'{x}..'
+                else:
+                    pat = f'{x} | {x + 2}'
+                arms.append(f'{pat} => {body}')
+            if r.random() < 0.5:
+                arms.append(r.choice(['_ => 1', f'q => q + {r.randint(0, 9)}']))
+            scr = f'({a} & {r.choice([7, 15, 31, 255])}) + {base}' if r.random() < 0.7 else a
+            return f'(match {scr} {{ ' + ', '.join(arms) + ' })'
+        return f'(if {a} > {b} && {b} != 3 || {a} == 0 {{ 1 }} else {{ 0 }})'
+
+    def stmts(vars_, muts, depth, fns, ind, loops):
+        lines = []
+        for _ in range(r.randint(1, 4)):
+            k = r.random()
+            if k < 0.12 and [x for x in arrs if x[2]]:
+                name, n, _ = r.choice([x for x in arrs if x[2]])
+                op = r.choice(['=', '+=', '-='])
+                lines.append(f'{ind}{name}[{index(expr(vars_, 2, fns), name, n)}] {op} {expr(vars_, 2, fns)};')
+            elif k < 0.18 and arrs:
+                name, n, _ = r.choice(arrs)
+                i = f'j{r.randint(0, 9999)}'
+                v = r.choice(muts) if muts else None
+                lo = r.choice(['0', '1', f'{name}.len / 2'])
+                bound = r.choice([f'{name}.len', f'{name}.len - 1', f'{name}.len + 1' if r.random() < 0.1 else f'{name}.len'])
+                lines.append(f'{ind}let mut {i} = {lo};')
+                lines.append(f'{ind}while {i} < {bound} {{')
+                if v:
+                    lines.append(f'{ind}    {v} += {name}[{i}] * {r.randint(1, 9)};')
+                if r.random() < 0.5:
+                    lines.append(f'{ind}    if {i} + 1 < {name}.len {{ {v or "0"} += {name}[{i} + 1]; }};' if v else f'{ind}    {i} += 0;')
+                lines.append(f'{ind}    {i} += 1;')
+                lines.append(f'{ind}}};')
+            elif k < 0.4 and muts:
+                v = r.choice(muts)
+                op = r.choice(['=', '+=', '-='])
+                lines.append(f'{ind}{v} {op} {expr(vars_, 3, fns)};')
+            elif k < 0.55 and depth > 0:
+                lines.append(f'{ind}if {expr(vars_, 2, fns)} > {expr(vars_, 2, fns)} {{')
+                lines += stmts(vars_, muts, depth - 1, fns, ind + '    ', loops)
+                lines.append(f'{ind}}} else {{')
+                lines += stmts(vars_, muts, depth - 1, fns, ind + '    ', loops)
+                lines.append(f'{ind}}};')
+            elif k < 0.7 and depth > 0:
+                i = f'i{len(loops)}_{r.randint(0, 999)}'
+                lines.append(f'{ind}let mut {i} = 0;')
+                lines.append(f'{ind}while {i} < {r.randint(0, 12)} {{')
+                lines.append(f'{ind}    {i} += 1;')
+                body = stmts(vars_ + [i], muts, depth - 1, fns, ind + '    ', loops + [i])
+                if r.random() < 0.3:
+                    body.append(f'{ind}    if {expr(vars_, 1, fns)} == 3 {{ continue; }};')
+                if r.random() < 0.3:
+                    body.append(f'{ind}    if {expr(vars_, 1, fns)} == 5 {{ break; }};')
+                lines += body
+                lines.append(f'{ind}}};')
+            elif k < 0.78 and depth > 0 and muts:
+                v = r.choice(muts)
+                c = f'c{r.randint(0, 9999)}'
+                lines.append(f'{ind}let mut {c} = 0;')
+                lines.append(f'{ind}{v} = loop {{ {c} += 1; if {c} > {r.randint(0, 9)} {{ break {expr(vars_, 2, fns)}; }}; {v} += {c}; }};')
+            elif k < 0.83 and depth > 0:
+                lines.append(f'{ind}if {expr(vars_, 2, fns)} == {r.randint(0, 3)} {{ return {expr(vars_, 2, fns)}; }};')
+            else:
+                v = f'l{r.randint(0, 99999)}'
+                lines.append(f'{ind}let {v} = {expr(vars_, 3, fns)};')
+                vars_ = vars_ + [v]
+        return lines
+
+    fns = []
+    sfns = []
+    for i in range(r.randint(0, 2)):
+        # slice functions: sum-like loops over a slice param
+        name = f's{i}'
+        u8 = r.random() < 0.3
+        arrs[:] = [('xs', None, False)]
+        lines = [f'fn {name}(xs: []{"u8" if u8 else "i64"}, q: i64) i64 {{', '    let mut m0 = q;', '    let mut m1 = 0;']
+        lines += stmts(['q', 'm0', 'm1'], ['m0', 'm1'], 2, fns, '    ', [])
+        lines.append('    m0 + m1')
+        lines.append('}')
+        out.append('\n'.join(lines))
+        sfns.append((name, u8))
+    for i in range(nfn):
+        n = r.randint(0, 4)
+        params = [f'p{j}' for j in range(n)]
+        attr = ''
+        c = r.random()
+        if c < 0.2:
+            attr = '[|inline(always)|]\n'
+        elif c < 0.3:
+            attr = '[|inline(never)|]\n'
+        name = f'f{i}'
+        muts = ['m0', 'm1']
+        lines = [f'{attr}fn {name}(' + ', '.join(f'{p}: i64' for p in params) + ') i64 {']
+        arrs[:] = []
+        lines.append(f'    let mut m0 = {expr(params, 2, fns)};')
+        lines.append(f'    let mut m1 = {expr(params, 2, fns)};')
+        if r.random() < 0.6:
+            na = r.choice([1, 3, 4, 8, 16, 100])
+            c = r.random()
+            if c < 0.4:
+                lines.append(f'    let mut a0 = [{expr(params, 1, fns)}] * {na};')
+            elif c < 0.7:
+                lines.append(f'    let mut a0 = [' + ', '.join(expr(params, 1, fns) for _ in range(na if na < 10 else 5)) + '];')
+                na = na if na < 10 else 5
+            else:
+                lines.append(f'    let mut a0: [{na}]i64;')
+            arrs.append(('a0', na, True))
+            if r.random() < 0.5:
+                nb = r.choice([4, 16, 37])
+                lines.append(f'    let mut b0: [{nb}]u8;')
+                arrs.append(('b0', nb, True))
+            if r.random() < 0.4:
+                lines.append(f'    let s0 = a0[{r.randint(0, 2)}..{r.choice(["", "a0.len", "a0.len - 1", "2"])}];')
+                arrs.append(('s0', None, False))
+        for sname, u8 in sfns:
+            srcs = [x for x in arrs if (x[0] == 'b0') == u8]
+            if srcs and r.random() < 0.7:
+                lines.append(f'    m1 += {sname}({srcs[0][0]}, {expr(params, 1, fns)});')
+        lines += stmts(params + muts, muts, 3, fns, '    ', [])
+        lines.append(f'    {expr(params + muts, 3, fns)}')
+        lines.append('}')
+        out.append('\n'.join(lines))
+        fns.append((name, n))
+    # main folds all results
+    body = ['fn main() i32 {', '    let mut h = 0;']
+    for name, n in fns:
+        for _ in range(2):
+            args = ', '.join(str(r.randint(-20, 20)).replace('-', '0 - ') for _ in range(n))
+            body.append(f'    h = h * 31 + {name}({args});')
+    body.append('    h & 255')
+    body.append('}')
+    out.append('\n'.join(body))
+    return '\n\n'.join(out) + '\n'
+
+LEVELS = [['-O0'], ['-O1'], ['-O2']]
+
+def run(risk, path, flags):
+    exe = path[:-3]
+    p = subprocess.run([risk, *flags, '--emit', 'exe', path], capture_output=True, text=True)
+    if p.returncode != 0:
+        return ('compile', (p.stdout + p.stderr)[:400])
+    try:
+        q = subprocess.run([exe], capture_output=True, timeout=10)
+    except subprocess.TimeoutExpired:
+        return ('timeout', '')
+    return ('ok', q.returncode)
+
+def check(risk, name, seed, src, runs, work):
+    """prints and keeps `<name>-<seed>.rk` when its runs do not all agree with the first, true when they do"""
+    path = os.path.join(work, f'{name}-{seed}.rk')
+    with open(path, 'w') as file:
+        file.write(src)
+    res = [run(risk, path, flags) for flags in runs]
+    if res[0][0] == 'ok' and all(x == res[0] for x in res[1:]):
+        return True
+    print(seed, ' '.join(f'{" ".join(flags)}={x}' for flags, x in zip(runs, res)))
+    with open(f'{name}-{seed}.rk', 'w') as file:
+        file.write(src)
+    return False
+
+if __name__ == '__main__':
+    risk = os.path.abspath(sys.argv[1])
+    start, count = int(sys.argv[2]), int(sys.argv[3])
+    runs = LEVELS + [['-O2', flag] for flag in sys.argv[4:]]
+    bad = 0
+    with tempfile.TemporaryDirectory() as work:
+        for seed in range(start, start + count):
+            bad += not check(risk, 'fuzz', seed, gen(seed), runs, work)
+    print('bad', bad)
+    sys.exit(bad != 0)